@@ -0,0 +1,414 @@
+/*
+ * Microbenchmarks for the airport building blocks.
+ *
+ *   gcc -O2 -o bench/microbench bench/microbench.c -pthread
+ *   ./bench/microbench [-o op] [-d depths] [-p procs] [-n iters] [-L log_lines]
+ *
+ * Each op below mirrors the code it is named after, taking the same shared
+ * lock the real processes use. The state lives in an anonymous shared mapping
+ * so "-p N" forks N processes that hammer the same queue at once. Every op
+ * leaves the queue at the depth it found it, so the depth stays fixed for the
+ * whole run. Results are ns/op averaged over the processes, plus cycles,
+ * instructions and LLC misses per op when perf_event_open() is allowed.
+ *
+ * To measure a replacement data structure, add a row to ops[] that runs it
+ * against the same depths and process counts.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../shared.h"
+
+#define LOGFILE "airport_log.txt"
+#define TAIL_LINES 12
+#define MAX_SETTINGS 16
+
+typedef struct {
+    double ns_per_op;
+    double cycles;         /* per op, < 0 when counters are unavailable */
+    double instructions;
+    double llc_misses;
+} result_t;
+
+typedef struct {
+    const char *name;
+    const char *mirrors;
+    int uses_depth;
+    int iter_div;          /* slow ops run iters / iter_div times */
+    void (*run)(void);
+} op_t;
+
+static shm_state_t *st = NULL;
+static volatile int *start_gate = NULL;
+static result_t *results = NULL;
+static int target_id = 0;
+
+void die(const char *msg) { perror(msg); exit(1); }
+
+/* ---- ops, mirroring producer.c / consumer.c / monitor.c ---- */
+
+void make_flight(flight_t *f, const char *name, int type, int duration_ms, int emergency) {
+    memset(f, 0, sizeof(*f));
+    f->used = 1;
+    f->id = st->next_id++;
+    strncpy(f->name, name, MAX_NAME_LEN-1);
+    f->type = type;
+    f->emergency = emergency ? 1 : 0;
+    f->duration_ms = duration_ms;
+}
+
+void queue_push(const flight_t *f) {
+    int idx = st->q_tail;
+    st->q[idx] = *f;
+    st->q[idx].used = 1;
+    st->q_tail = (st->q_tail + 1) % MAX_FLIGHTS;
+    st->q_count++;
+}
+
+/* add_flight() -> enqueue_flight() without spill; the push is undone under the same lock */
+void op_enqueue(void) {
+    flight_t f;
+    shm_lock(st);
+    if (st->q_count < MAX_FLIGHTS) {
+        make_flight(&f, "BENCH-1", FL_LANDING, 2000, 0);
+        queue_push(&f);
+        pthread_cond_signal(&st->items_cv);
+        st->q_tail = (st->q_tail - 1 + MAX_FLIGHTS) % MAX_FLIGHTS;
+        st->q[st->q_tail].used = 0;
+        st->q_count--;
+    }
+    shm_unlock(st);
+}
+
+int find_eligible_index(void) {
+    if (st->q_count == 0) return -1;
+    if (!st->severe_weather) return st->q_head;
+    int idx = st->q_head;
+    for (int k=0;k<st->q_count;k++) {
+        flight_t *f = &st->q[idx];
+        if (f->emergency && f->type == FL_LANDING) return idx;
+        idx = (idx+1)%MAX_FLIGHTS;
+    }
+    return -1;
+}
+
+/* consumer.c main loop: dequeue by shifting the tail down; the flight is pushed back */
+void op_dequeue(void) {
+    shm_lock(st);
+    int eligible_idx = find_eligible_index();
+    if (eligible_idx >= 0) {
+        flight_t f = st->q[eligible_idx];
+        int idx = eligible_idx;
+        while (1) {
+            int next = (idx + 1) % MAX_FLIGHTS;
+            if (next == st->q_tail) {
+                st->q[idx].used = 0;
+                break;
+            } else {
+                st->q[idx] = st->q[next];
+            }
+            idx = next;
+        }
+        st->q_tail = (st->q_tail - 1 + MAX_FLIGHTS) % MAX_FLIGHTS;
+        st->q_count--;
+        pthread_cond_broadcast(&st->spaces_cv);
+        queue_push(&f);
+    }
+    shm_unlock(st);
+}
+
+/* mark_emergency() looking up the last queued id, without the printf */
+void op_emergency(void) {
+    shm_lock(st);
+    int found = 0;
+    int idx = st->q_head;
+    for (int k=0;k<st->q_count;k++) {
+        flight_t *f = &st->q[idx];
+        if (f->id == target_id) {
+            f->emergency = 1;
+            found = 1;
+            break;
+        }
+        idx = (idx+1) % MAX_FLIGHTS;
+    }
+    if (found) pthread_cond_signal(&st->items_cv);
+    shm_unlock(st);
+}
+
+/* the monitor's per-frame copy of the whole segment */
+void op_snapshot(void) {
+    shm_state_t snapshot;
+    shm_lock(st);
+    snapshot = *st;
+    shm_unlock(st);
+    __asm__ __volatile__("" : : "r"(&snapshot) : "memory");
+}
+
+int read_log_tail(char **out_lines, int max_lines) {
+    for (int i=0;i<max_lines;i++) out_lines[i] = NULL;
+    FILE *f = fopen(LOGFILE, "r");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long pos = ftell(f);
+    int lines = 0;
+    long cur = pos;
+    char *buf = NULL;
+
+    /* stop at max_lines: one more would land in out_lines[-1] */
+    while (cur > 0 && lines < max_lines) {
+        cur--;
+        fseek(f, cur, SEEK_SET);
+        int c = fgetc(f);
+        if (c == '\n') {
+            long start = ftell(f);
+            size_t len = pos - start;
+            fseek(f, start, SEEK_SET);
+            free(buf);
+            buf = malloc(len+1);
+            if (!buf) break;
+            fread(buf, 1, len, f);
+            buf[len] = 0;
+            out_lines[max_lines - lines - 1] = strdup(buf);
+            lines++;
+            pos = cur;
+        }
+    }
+  
+    if (lines < max_lines) {
+        fseek(f, 0, SEEK_SET);
+        free(buf);
+        buf = NULL;
+        long start = 0;
+        size_t len = pos - start;
+        if (len > 0) {
+            buf = malloc(len+1);
+            if (buf) {
+                fread(buf, 1, len, f);
+                buf[len] = 0;
+                out_lines[max_lines - lines - 1] = strdup(buf);
+                lines++;
+            }
+        }
+    }
+    free(buf);
+    fclose(f);
+    return lines;
+}
+
+/* monitor.c read_log_tail() for the 12-line "Recent Log" pane */
+void op_logtail(void) {
+    char *lines[TAIL_LINES+1];
+    read_log_tail(lines, TAIL_LINES);
+    for (int i=0;i<TAIL_LINES;i++) free(lines[i]);
+}
+
+static const op_t ops[] = {
+    { "enqueue",   "producer.c add_flight()",        1, 1,   op_enqueue },
+    { "dequeue",   "consumer.c dequeue + shift",     1, 1,   op_dequeue },
+    { "emergency", "producer.c mark_emergency()",    1, 1,   op_emergency },
+    { "snapshot",  "monitor.c shm_state_t copy",     0, 10,  op_snapshot },
+    { "logtail",   "monitor.c read_log_tail()",      0, 100, op_logtail },
+};
+#define N_OPS ((int)(sizeof(ops)/sizeof(ops[0])))
+
+/* ---- hardware counters ---- */
+
+static int perf_open(int group_fd, unsigned long config) {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = config;
+    pe.disabled = group_fd < 0;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    pe.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(__NR_perf_event_open, &pe, 0, -1, group_fd, 0);
+}
+
+/* returns the group leader fd, or -1 when counters are unavailable */
+int perf_start(void) {
+    int leader = perf_open(-1, PERF_COUNT_HW_CPU_CYCLES);
+    if (leader < 0) return -1;
+    if (perf_open(leader, PERF_COUNT_HW_INSTRUCTIONS) < 0 ||
+        perf_open(leader, PERF_COUNT_HW_CACHE_MISSES) < 0) {
+        close(leader);
+        return -1;
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return leader;
+}
+
+void perf_stop(int leader, long iters, result_t *r) {
+    r->cycles = r->instructions = r->llc_misses = -1;
+    if (leader < 0) return;
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    struct { uint64_t nr; uint64_t values[3]; } data;
+    if (read(leader, &data, sizeof(data)) == (ssize_t)sizeof(data) && data.nr == 3) {
+        r->cycles = (double) data.values[0] / iters;
+        r->instructions = (double) data.values[1] / iters;
+        r->llc_misses = (double) data.values[2] / iters;
+    }
+    close(leader);
+}
+
+/* ---- harness ---- */
+
+void fill_queue(int depth) {
+    shm_lock(st);
+    st->q_head = st->q_tail = st->q_count = 0;
+    for (int i=0;i<MAX_FLIGHTS;i++) st->q[i].used = 0;
+    st->severe_weather = 0;
+    for (int i=0;i<depth;i++) {
+        flight_t f;
+        make_flight(&f, "", i % 2 ? FL_TAKEOFF : FL_LANDING, 2000, 0);
+        snprintf(f.name, sizeof(f.name), "BENCH-%d", i);
+        queue_push(&f);
+    }
+    target_id = depth > 0 ? st->q[(st->q_tail - 1 + MAX_FLIGHTS) % MAX_FLIGHTS].id : -1;
+    shm_unlock(st);
+}
+
+void write_log(long lines) {
+    FILE *f = fopen(LOGFILE, "w");
+    if (!f) die("fopen log");
+    for (long i=0;i<lines;i++) {
+        fprintf(f, "[consumer] Assigned runway %ld to flight id=%ld (child pid=%ld)\n", i % RUNWAYS + 1, i, 10000 + i);
+    }
+    fclose(f);
+}
+
+void worker(const op_t *op, long iters, int slot, int procs) {
+    __atomic_add_fetch(start_gate, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(start_gate, __ATOMIC_ACQUIRE) < procs) {}
+
+    int leader = perf_start();
+    long t0 = now_ns();
+    for (long i=0;i<iters;i++) op->run();
+    long t1 = now_ns();
+    perf_stop(leader, iters, &results[slot]);
+    results[slot].ns_per_op = (double)(t1 - t0) / iters;
+}
+
+void run_setting(const op_t *op, int depth, int procs, long iters) {
+    iters /= op->iter_div;
+    if (iters < 1) iters = 1;
+    if (op->uses_depth) fill_queue(depth);
+    *start_gate = 0;
+    for (int p=0;p<procs;p++) {
+        pid_t pid = fork();
+        if (pid < 0) die("fork");
+        if (pid == 0) {
+            worker(op, iters, p, procs);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {}
+
+    result_t sum = {0, 0, 0, 0};
+    int have_counters = 1;
+    for (int p=0;p<procs;p++) {
+        sum.ns_per_op += results[p].ns_per_op;
+        if (results[p].cycles < 0) have_counters = 0;
+        sum.cycles += results[p].cycles;
+        sum.instructions += results[p].instructions;
+        sum.llc_misses += results[p].llc_misses;
+    }
+    char depth_s[16];
+    if (op->uses_depth) snprintf(depth_s, sizeof(depth_s), "%d", depth);
+    else strcpy(depth_s, "-");
+    printf("%-10s %6s %6d %10ld %12.1f", op->name, depth_s, procs, iters, sum.ns_per_op / procs);
+    if (have_counters) {
+        printf(" %10.1f %10.1f %10.2f\n", sum.cycles / procs, sum.instructions / procs, sum.llc_misses / procs);
+    } else {
+        printf(" %10s %10s %10s\n", "n/a", "n/a", "n/a");
+    }
+    fflush(stdout);
+}
+
+int parse_list(const char *spec, int *out, int max) {
+    int n = 0;
+    char *copy = strdup(spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && n < max; tok = strtok_r(NULL, ",", &save)) {
+        out[n++] = atoi(tok);
+    }
+    free(copy);
+    return n;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-o op] [-d depths] [-p procs] [-n iters] [-L log_lines]\n"
+            "  -o op      run only this op (default: all)\n"
+            "  -d depths  comma-separated queue depths (default 0,16,128,255)\n"
+            "  -p procs   comma-separated contending process counts (default 1,2,4)\n"
+            "  -n iters   iterations per process (default 200000; slow ops run fewer)\n"
+            "  -L lines   lines in the generated log for logtail (default 100000)\n"
+            "ops:", prog);
+    for (int i=0;i<N_OPS;i++) fprintf(stderr, " %s", ops[i].name);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int depths[MAX_SETTINGS] = { 0, 16, 128, MAX_FLIGHTS - 1 };
+    int n_depths = 4;
+    int procs[MAX_SETTINGS] = { 1, 2, 4 };
+    int n_procs = 3;
+    long iters = 200000;
+    long log_lines = 100000;
+    const char *only = NULL;
+    int opt_c;
+    while ((opt_c = getopt(argc, argv, "o:d:p:n:L:")) != -1) {
+        if (opt_c == 'o') only = optarg;
+        else if (opt_c == 'd') n_depths = parse_list(optarg, depths, MAX_SETTINGS);
+        else if (opt_c == 'p') n_procs = parse_list(optarg, procs, MAX_SETTINGS);
+        else if (opt_c == 'n') iters = atol(optarg);
+        else if (opt_c == 'L') log_lines = atol(optarg);
+        else usage(argv[0]);
+    }
+    for (int i=0;i<n_depths;i++) if (depths[i] < 0 || depths[i] > MAX_FLIGHTS - 1) usage(argv[0]);
+    for (int i=0;i<n_procs;i++) if (procs[i] < 1 || procs[i] > 256) usage(argv[0]);
+    if (iters < 1) usage(argv[0]);
+
+    st = mmap(NULL, sizeof(shm_state_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (st == MAP_FAILED) die("mmap state");
+    shm_init_sync(st);
+    st->next_id = 1;
+    start_gate = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    results = mmap(NULL, 256 * sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (start_gate == MAP_FAILED || results == MAP_FAILED) die("mmap results");
+
+    /* logtail reads LOGFILE from the cwd, so give it a private directory */
+    char dir[] = "/tmp/airport-bench-XXXXXX";
+    if (!mkdtemp(dir)) die("mkdtemp");
+    if (chdir(dir) < 0) die("chdir");
+
+    printf("%-10s %6s %6s %10s %12s %10s %10s %10s\n",
+           "op", "depth", "procs", "iters", "ns/op", "cycles", "instr", "llc-miss");
+    int ran = 0;
+    for (int o=0;o<N_OPS;o++) {
+        const op_t *op = &ops[o];
+        if (only && strcmp(only, op->name) != 0) continue;
+        ran = 1;
+        if (strcmp(op->name, "logtail") == 0) write_log(log_lines);
+        int nd = op->uses_depth ? n_depths : 1;
+        for (int d=0;d<nd;d++) {
+            for (int p=0;p<n_procs;p++) run_setting(op, depths[d], procs[p], iters);
+        }
+    }
+
+    unlink(LOGFILE);
+    if (chdir("/") == 0) rmdir(dir);
+    if (!ran) usage(argv[0]);
+    return 0;
+}
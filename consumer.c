@@ -6,44 +6,157 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <sys/shm.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <sched.h>
+#include <signal.h>
 #include <errno.h>
 #include "shared.h"
 
-#define SEM_MUTEX_NAME "/airport_mutex"
-#define SEM_ITEMS_NAME "/airport_items"
-#define SEM_SPACES_NAME "/airport_spaces"
-#define SEM_RUNWAYS_NAME "/airport_runways"
-
 static shm_state_t *st = NULL;
-static int shm_id = -1;
-static sem_t *sem_mutex = NULL;
-static sem_t *sem_items = NULL;
-static sem_t *sem_spaces = NULL;
-static sem_t *sem_runways = NULL;
+static spill_t *spill = NULL;
+static long spill_retry_ns = 0;
+static int spill_warned = 0;
+
+/* real-time options, see usage() */
+static cpu_set_t consumer_cpus;
+static cpu_set_t worker_cpus;
+static int pin_consumer = 0;
+static int pin_workers = 0;
+static int rt_prio = 0;
+static int lock_memory = 0;
+static int huge_pages = 0;
+static int hog_count = 0;
 
 
 void die(const char *msg) { perror(msg); exit(1); }
 
 void open_ipc() {
-    shm_id = shmget(SHM_KEY, sizeof(shm_state_t), IPC_CREAT | 0666);
-    if (shm_id < 0) die("shmget consumer");
-    st = (shm_state_t*) shmat(shm_id, NULL, 0);
-    if (st == (void*)-1) die("shmat consumer");
+    st = shm_attach(1, huge_pages ? SHM_HUGETLB : 0);
+    if (!st) die("shm_attach consumer");
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-c cpus] [-w cpus] [-p prio] [-m] [-H] [-g hogs]\n"
+            "  -c cpus  pin the consumer to a CPU list, e.g. 2 or 2,4-5\n"
+            "  -w cpus  pin runway workers to a CPU list\n"
+            "  -p prio  run consumer and workers under SCHED_FIFO at prio (1-99)\n"
+            "  -m       mlockall() so shared memory and the spill file stay resident\n"
+            "  -H       back the segment with huge pages (only if we create it)\n"
+            "  -g hogs  start N busy-loop processes as synthetic CPU load\n", prog);
+    exit(1);
+}
+
+int parse_cpus(const char *spec, cpu_set_t *set) {
+    CPU_ZERO(set);
+    char *copy = strdup(spec);
+    char *save = NULL;
+    int n = 0;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int lo, hi;
+        if (sscanf(tok, "%d-%d", &lo, &hi) != 2) {
+            if (sscanf(tok, "%d", &lo) != 1) { free(copy); return -1; }
+            hi = lo;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) { free(copy); return -1; }
+        for (int c=lo;c<=hi;c++) { CPU_SET(c, set); n++; }
+    }
+    free(copy);
+    return n > 0 ? 0 : -1;
+}
+
+/* applied to the consumer at startup and to each runway worker after fork */
+void apply_rt(cpu_set_t *cpus, int pin, const char *who) {
+    if (pin && sched_setaffinity(0, sizeof(cpu_set_t), cpus) < 0) {
+        fprintf(stderr, "[%s pid=%d] ", who, getpid());
+        perror("sched_setaffinity");
+    }
+    if (rt_prio > 0) {
+        struct sched_param sp = { .sched_priority = rt_prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+            fprintf(stderr, "[%s pid=%d] ", who, getpid());
+            perror("sched_setscheduler SCHED_FIFO");
+        }
+    }
+}
+
+/* MCL_CURRENT faults in and locks every mapped page, the shm segment included */
+void lock_memory_pages() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) perror("mlockall");
+}
 
-    sem_mutex = sem_open(SEM_MUTEX_NAME, O_CREAT, 0666, 1);
-    if (sem_mutex == SEM_FAILED) die("sem_open mutex");
-    sem_items = sem_open(SEM_ITEMS_NAME, O_CREAT, 0666, 0);
-    if (sem_items == SEM_FAILED) die("sem_open items");
-    sem_spaces = sem_open(SEM_SPACES_NAME, O_CREAT, 0666, MAX_FLIGHTS);
-    if (sem_spaces == SEM_FAILED) die("sem_open spaces");
-    sem_runways = sem_open(SEM_RUNWAYS_NAME, O_CREAT, 0666, RUNWAYS);
-    if (sem_runways == SEM_FAILED) die("sem_open runways");
+/* synthetic load: plain SCHED_OTHER spinners, on the consumer's CPUs if pinned */
+void start_hogs() {
+    for (int i=0;i<hog_count;i++) {
+        pid_t pid = fork();
+        if (pid < 0) die("fork hog");
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (pin_consumer) sched_setaffinity(0, sizeof(cpu_set_t), &consumer_cpus);
+            volatile unsigned long spin = 0;
+            for (;;) spin++;
+        }
+    }
+    printf("[consumer] started %d CPU hog(s)\n", hog_count);
 }
 
+/* the spill file is created by a producer run with -s; attach once it has published st->spill_path */
+int open_spill() {
+    if (spill) return 0;
+    char path[SPILL_PATH_MAX];
+    shm_lock(st);
+    strcpy(path, st->spill_path);
+    int waiting = st->spill_count;
+    shm_unlock(st);
+    if (!path[0]) return -1;
+
+    int fd = open(path, O_RDWR);
+    struct stat sb;
+    if (fd >= 0 && (fstat(fd, &sb) < 0 || sb.st_size < (off_t)sizeof(spill_t))) {
+        close(fd);
+        fd = -1;
+        errno = EINVAL;
+    }
+    if (fd < 0) {
+        /* flights are stranded on disk until this is fixed, so say so once */
+        if (waiting > 0 && !spill_warned) {
+            fprintf(stderr, "[consumer] cannot attach spill file %s (%s); %d spilled flights waiting\n",
+                    path, strerror(errno), waiting);
+            spill_warned = 1;
+        }
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(spill_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | (lock_memory ? MAP_POPULATE : 0), fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    spill = (spill_t*) p;
+    return 0;
+}
+
+/*
+ * caller holds st->lock; refills freed slots from the spill ring in order.
+ * A file from an earlier segment is left alone until a producer adopts it.
+ */
+void drain_spill() {
+    if (spill->generation != st->generation) return;
+    while (spill->count > 0 && st->q_count < MAX_FLIGHTS) {
+        int idx = st->q_tail;
+        st->q[idx] = spill->q[spill->head];
+        st->q[idx].used = 1;
+        st->q_tail = (st->q_tail + 1) % MAX_FLIGHTS;
+        st->q_count++;
+        printf("[consumer] Moved spilled id=%d name=%s into queue\n", st->q[idx].id, st->q[idx].name);
+        spill->head = (spill->head + 1) % SPILL_MAX;
+        spill->count--;
+    }
+    st->spill_count = spill->count;
+}
 
 void remove_at_index(int idx_in_array) {
     int idx = idx_in_array;
@@ -84,6 +197,99 @@ int find_free_runway() {
     return -1;
 }
 
+/* caller holds st->lock; frees runways held by children that died without releasing them */
+void reap_children() {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int r=0;r<RUNWAYS;r++) {
+            if (st->runway_in_use[r] == pid) {
+                st->runway_in_use[r] = 0;
+                st->runway_freed_ns[r] = now_ns();
+                printf("[consumer] child pid=%d died holding runway %d, released\n", pid, r+1);
+                pthread_cond_broadcast(&st->runway_cv);
+            }
+        }
+    }
+}
+
+void hist_fold(hist_agg_t *a, const hist_sample_t *smp) {
+    for (int m=0;m<HIST_METRICS;m++) {
+        int v = smp->v[m];
+        if (a->n == 0 || v < a->min[m]) a->min[m] = v;
+        if (a->n == 0 || v > a->max[m]) a->max[m] = v;
+        a->sum[m] += v;
+    }
+    a->n++;
+}
+
+/* O(HIST_TIERS) per sample: each tier folds the sample into its open bucket */
+void history_add(history_t *h, const hist_sample_t *smp, long t_s) {
+    h->sec[h->head] = *smp;
+    h->head = (h->head + 1) % HIST_SECONDS;
+    if (h->count < HIST_SECONDS) h->count++;
+
+    for (int i=0;i<HIST_TIERS;i++) {
+        hist_tier_t *t = &h->tier[i];
+        long id = t_s / t->span_s;
+        if (t->count == 0) {
+            t->head = 0;
+            t->count = 1;
+            t->cur_id = id;
+            memset(&t->b[0], 0, sizeof(hist_agg_t));
+        } else if (id > t->cur_id) {
+            /* open one bucket per elapsed span so gaps show up as empty buckets */
+            long gap = id - t->cur_id;
+            if (gap > t->slots) gap = t->slots;
+            for (long k=0;k<gap;k++) {
+                t->head = (t->head + 1) % t->slots;
+                memset(&t->b[t->head], 0, sizeof(hist_agg_t));
+                if (t->count < t->slots) t->count++;
+            }
+            t->cur_id = id;
+        }
+        hist_fold(&t->b[t->head], smp);
+    }
+}
+
+/* caller holds st->lock; records one sample per elapsed second */
+void history_tick() {
+    history_t *h = &st->hist;
+    long now = now_ns();
+    if (h->next_ns == 0) {
+        h->tier[0].span_s = 60;
+        h->tier[0].slots = 60;
+        h->tier[1].span_s = 3600;
+        h->tier[1].slots = 24;
+        h->last_dispatched = st->total_dispatched;
+        h->next_ns = now + 1000000000L;
+        return;
+    }
+    if (now < h->next_ns) return;
+
+    hist_sample_t smp;
+    memset(&smp, 0, sizeof(smp));
+    smp.t_s = now / 1000000000L;
+    smp.v[HM_QUEUE] = st->q_count;
+    smp.v[HM_RATE] = st->total_dispatched - h->last_dispatched;
+    h->last_dispatched = st->total_dispatched;
+    for (int r=0;r<RUNWAYS;r++) {
+        if (st->runway_in_use[r]) {
+            smp.v[HM_OCCUPANCY]++;
+            smp.runway_mask |= 1u << r;
+        }
+    }
+    int idx = st->q_head;
+    for (int k=0;k<st->q_count;k++) {
+        if (st->q[idx].emergency) smp.v[HM_EMERGENCY]++;
+        idx = (idx+1)%MAX_FLIGHTS;
+    }
+    history_add(h, &smp, smp.t_s);
+
+    /* if we fell behind, skip ahead rather than emit back-to-back samples */
+    h->next_ns += 1000000000L;
+    if (h->next_ns <= now) h->next_ns = now + 1000000000L;
+}
+
 
 void child_occupy_runway(int runway_idx, int duration_ms, int flight_id, char *name) {
     
@@ -92,40 +298,87 @@ void child_occupy_runway(int runway_idx, int duration_ms, int flight_id, char *n
 
     usleep(duration_ms * 1000);
 
-    sem_wait(sem_mutex);
+    shm_lock(st);
+    /* a short flight can land before the parent has published our pid */
+    while (st->runway_in_use[runway_idx] == RUNWAY_RESERVED) shm_wait(st, &st->runway_cv);
     if (st->runway_in_use[runway_idx] == getpid()) {
         st->runway_in_use[runway_idx] = 0;
+        st->runway_freed_ns[runway_idx] = now_ns();
         st->total_assigned++;
         st->total_busy_ms += duration_ms;
         printf("[child pid=%d] Freed runway %d for flight id=%d\n", getpid(), runway_idx+1, flight_id);
     } else {
         printf("[child pid=%d] Warning: runway %d not owned by me\n", getpid(), runway_idx+1);
     }
-    sem_post(sem_mutex);
-
-    sem_post(sem_runways);
+    /* broadcast: other children may be waiting on runway_cv for their own pid */
+    pthread_cond_broadcast(&st->runway_cv);
+    shm_unlock(st);
 
     exit(0);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    int opt_c;
+    while ((opt_c = getopt(argc, argv, "c:w:p:mHg:")) != -1) {
+        if (opt_c == 'c') {
+            if (parse_cpus(optarg, &consumer_cpus) < 0) usage(argv[0]);
+            pin_consumer = 1;
+        } else if (opt_c == 'w') {
+            if (parse_cpus(optarg, &worker_cpus) < 0) usage(argv[0]);
+            pin_workers = 1;
+        } else if (opt_c == 'p') {
+            rt_prio = atoi(optarg);
+            if (rt_prio < sched_get_priority_min(SCHED_FIFO) || rt_prio > sched_get_priority_max(SCHED_FIFO)) usage(argv[0]);
+        } else if (opt_c == 'm') {
+            lock_memory = 1;
+        } else if (opt_c == 'H') {
+            huge_pages = 1;
+        } else if (opt_c == 'g') {
+            hog_count = atoi(optarg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
     open_ipc();
+    if (hog_count > 0) start_hogs();
+    apply_rt(&consumer_cpus, pin_consumer, "consumer");
+    if (lock_memory) lock_memory_pages();
     printf("Consumer (scheduler) started. Waiting for flights...\n");
 
+    /* a previous consumer may have died between reserving a runway and forking */
+    shm_lock(st);
+    int cleared = 0;
+    for (int r=0;r<RUNWAYS;r++) {
+        if (st->runway_in_use[r] == RUNWAY_RESERVED) {
+            st->runway_in_use[r] = 0;
+            cleared = 1;
+        }
+    }
+    /* an orphaned child may still be waiting for its slot to leave RESERVED */
+    if (cleared) pthread_cond_broadcast(&st->runway_cv);
+    /* each run gets its own latency histogram, so a -g run is not mixed with earlier ones */
+    memset(st->lat_hist, 0, sizeof(st->lat_hist));
+    st->lat_count = 0;
+    st->lat_min_ns = 0;
+    st->lat_max_ns = 0;
+    st->lat_sum_us = 0;
+    shm_unlock(st);
+
     while (1) {
-      
-        sem_wait(sem_items);
-
-        sem_wait(sem_mutex);
-        int eligible_idx = find_eligible_index();
-        if (eligible_idx == -1) {
-            
-            sem_post(sem_mutex);
-          
-            sem_post(sem_items);
-           
-            usleep(200000);
-            continue;
+        /* open/fstat/mmap stay outside the lock and are retried at most once a second */
+        if (!spill && now_ns() >= spill_retry_ns) {
+            open_spill();
+            spill_retry_ns = now_ns() + 1000000000L;
+        }
+
+        shm_lock(st);
+        int eligible_idx;
+        history_tick();
+        while ((eligible_idx = find_eligible_index()) == -1) {
+            struct timespec deadline = { st->hist.next_ns / 1000000000L, st->hist.next_ns % 1000000000L };
+            shm_timedwait(st, &st->items_cv, &deadline);
+            history_tick();
         }
 
        
@@ -150,46 +403,54 @@ int main() {
         printf("[consumer] Dequeued id=%d name=%s type=%s em=%d dur=%dms\n",
                f.id, f.name, (f.type==FL_LANDING?"LAND":"TKOF"), f.emergency, f.duration_ms);
 
-        sem_post(sem_mutex);
-        sem_post(sem_spaces);
-
-        sem_wait(sem_runways);
+        if (spill) drain_spill();
+        pthread_cond_broadcast(&st->spaces_cv);
 
-        sem_wait(sem_mutex);
-        int runway_idx = find_free_runway();
-        if (runway_idx < 0) {
-          
-            printf("[consumer] no free runway unexpectedly\n");
-            sem_post(sem_mutex);
-            sem_post(sem_runways);
-            continue;
+        /* timed so children killed mid-flight are still reaped and their runway freed */
+        int runway_idx;
+        int waited = 0;
+        while ((runway_idx = find_free_runway()) < 0) {
+            waited = 1;
+            /* wake for the next history sample too, or it is taken late while runways stay busy */
+            long wake_ns = now_ns() + 1000000000L;
+            if (st->hist.next_ns < wake_ns) wake_ns = st->hist.next_ns;
+            struct timespec deadline = { wake_ns / 1000000000L, wake_ns % 1000000000L };
+            shm_timedwait(st, &st->runway_cv, &deadline);
+            reap_children();
+            history_tick();
         }
-     
+
+        /* reserve the runway and fork outside the lock; the pid is published after */
+        st->runway_in_use[runway_idx] = RUNWAY_RESERVED;
+        shm_unlock(st);
+
+        fflush(stdout);
         pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-          
-            st->runway_in_use[runway_idx] = 0;
-            sem_post(sem_mutex);
-            sem_post(sem_runways);
-            continue;
-        } else if (pid == 0) {
-           
-            st->runway_in_use[runway_idx] = getpid();
-        
+        long dispatched_ns = now_ns();
+        if (pid == 0) {
             char name_local[MAX_NAME_LEN];
             strncpy(name_local, f.name, MAX_NAME_LEN-1);
             name_local[MAX_NAME_LEN-1] = 0;
-            sem_post(sem_mutex); 
+            apply_rt(&worker_cpus, pin_workers, "child");
             child_occupy_runway(runway_idx, f.duration_ms, f.id, name_local);
-        
-        } else {
-           
-            printf("[consumer] Assigned runway %d to flight id=%d (child pid=%d)\n", runway_idx+1, f.id, pid);
-            sem_post(sem_mutex);
-           
-            while (waitpid(-1, NULL, WNOHANG) > 0) {}
         }
+
+        shm_lock(st);
+        if (pid < 0) {
+            perror("fork");
+            st->runway_in_use[runway_idx] = 0;
+            pthread_cond_broadcast(&st->runway_cv);
+            shm_unlock(st);
+            continue;
+        }
+        st->runway_in_use[runway_idx] = pid;
+        pthread_cond_broadcast(&st->runway_cv);
+        st->total_dispatched++;
+        /* only a flight that sat waiting for this runway measures dispatch latency */
+        if (waited) lat_record(st, dispatched_ns - st->runway_freed_ns[runway_idx]);
+        printf("[consumer] Assigned runway %d to flight id=%d (child pid=%d)\n", runway_idx+1, f.id, pid);
+        reap_children();
+        shm_unlock(st);
     }
 
     return 0;
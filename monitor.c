@@ -4,7 +4,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <semaphore.h>
 #include <fcntl.h>
 #include <sys/shm.h>
 #include <sys/ipc.h>
@@ -16,7 +15,6 @@
 
 #include "shared.h"
 
-#define SEM_MUTEX_NAME "/airport_mutex"
 #define LOGFILE "airport_log.txt"
 
 
@@ -38,8 +36,6 @@ const char *SPINNER[] = { "|", "/", "-", "\\" };
 const int SPINNER_FRAMES = 4;
 
 static shm_state_t *st = NULL;
-static int shm_id = -1;
-static sem_t *sem_mutex = NULL;
 
 static struct termios orig_term;
 
@@ -57,19 +53,10 @@ void disable_raw_mode() {
     tcsetattr(STDIN_FILENO, TCSANOW, &orig_term);
 }
 
+/* attached read-write: taking the shared lock writes to the segment */
 int open_ipc() {
-    shm_id = shmget(SHM_KEY, sizeof(shm_state_t), 0666);
-    if (shm_id < 0) {
-        return -1;
-    }
-    st = (shm_state_t*) shmat(shm_id, NULL, SHM_RDONLY);
-    if (st == (void*) -1) {
-        st = NULL;
-        return -1;
-    }
-    sem_mutex = sem_open(SEM_MUTEX_NAME, 0);
-    if (sem_mutex == SEM_FAILED) sem_mutex = NULL;
-    return 0;
+    st = shm_attach(0, 0);
+    return st ? 0 : -1;
 }
 
 void close_ipc() {
@@ -77,10 +64,6 @@ void close_ipc() {
         shmdt(st);
         st = NULL;
     }
-    if (sem_mutex && sem_mutex != SEM_FAILED) {
-        sem_close(sem_mutex);
-        sem_mutex = NULL;
-    }
 }
 
 int read_log_tail(char **out_lines, int max_lines) {
@@ -91,10 +74,10 @@ int read_log_tail(char **out_lines, int max_lines) {
     long pos = ftell(f);
     int lines = 0;
     long cur = pos;
-    size_t bufcap = 0;
     char *buf = NULL;
 
-    while (cur > 0 && lines <= max_lines) {
+    /* stop at max_lines: one more would land in out_lines[-1] */
+    while (cur > 0 && lines < max_lines) {
         cur--;
         fseek(f, cur, SEEK_SET);
         int c = fgetc(f);
@@ -159,8 +142,31 @@ void print_header(const char *title) {
 }
 
 
-void draw_occupancy_bar(int width, int frame) {
-    int fill = (frame % (width)) + 1;
+/*
+ * k-th newest raw sample (k >= 1), or NULL once samples are older than
+ * window_s. Samples are stored in time order, so the walk can stop at the
+ * first stale one; seconds the consumer was down simply have no sample.
+ */
+const hist_sample_t *recent_sample(const history_t *h, int k, long now_s, int window_s) {
+    if (k > h->count) return NULL;
+    const hist_sample_t *smp = &h->sec[(h->head - k + HIST_SECONDS) % HIST_SECONDS];
+    long age = now_s - smp->t_s;
+    return (age >= 0 && age < window_s) ? smp : NULL;
+}
+
+/* fraction of the samples in the last 60 s in which runway r was busy */
+double runway_busy_fraction(const history_t *h, int r, long now_s) {
+    int n = 0, busy = 0;
+    const hist_sample_t *smp;
+    for (int k=1;(smp = recent_sample(h, k, now_s, 60));k++) {
+        n++;
+        if (smp->runway_mask & (1u << r)) busy++;
+    }
+    return n ? (double) busy / n : 0.0;
+}
+
+void draw_occupancy_bar(int width, double fraction) {
+    int fill = (int)(fraction * width + 0.5);
     printf("[");
     for (int i=0;i<width;i++) {
         if (i < fill) printf("■");
@@ -169,6 +175,61 @@ void draw_occupancy_bar(int width, int frame) {
     printf("]");
 }
 
+void hist_merge(hist_agg_t *into, const hist_agg_t *a, int m) {
+    if (a->n == 0) return;
+    if (into->n == 0 || a->min[m] < into->min[m]) into->min[m] = a->min[m];
+    if (into->n == 0 || a->max[m] > into->max[m]) into->max[m] = a->max[m];
+    into->sum[m] += a->sum[m];
+    into->n += a->n;
+}
+
+/* min/mean/max of metric m over the last 60 s, the last hour of minute buckets and the last day of hour buckets */
+void print_window_stats(const history_t *h, int m, long now_s) {
+    hist_agg_t win[1 + HIST_TIERS];
+    memset(win, 0, sizeof(win));
+    const hist_sample_t *smp;
+    for (int k=1;(smp = recent_sample(h, k, now_s, 60));k++) {
+        hist_agg_t one = { .n = 1 };
+        one.min[m] = one.max[m] = smp->v[m];
+        one.sum[m] = smp->v[m];
+        hist_merge(&win[0], &one, m);
+    }
+    for (int i=0;i<HIST_TIERS;i++) {
+        const hist_tier_t *t = &h->tier[i];
+        long now_id = now_s / t->span_s;
+        /* bucket d steps behind head covers cur_id - d; skip ones older than the tier's range */
+        for (int d=0;d<t->count;d++) {
+            if (now_id - (t->cur_id - d) >= t->slots) break;
+            hist_merge(&win[1+i], &t->b[(t->head - d + t->slots) % t->slots], m);
+        }
+    }
+    const char *label[1 + HIST_TIERS] = { "1m", "1h", "1d" };
+    printf("  %-12s", "");
+    for (int i=0;i<1+HIST_TIERS;i++) {
+        if (win[i].n == 0) printf("  %s -/-/-", label[i]);
+        else printf("  %s %d/%.1f/%d", label[i], win[i].min[m], (double) win[i].sum[m] / win[i].n, win[i].max[m]);
+    }
+    printf("   (min/mean/max)\n");
+}
+
+/* metric m over the last width seconds, oldest first, scaled to the window's max; blank where no sample */
+void draw_sparkline(const history_t *h, int m, int width, long now_s) {
+    static const char *BARS[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+    int cols[HIST_SECONDS];
+    int top = 1;
+    for (int i=0;i<width;i++) cols[i] = -1;
+    const hist_sample_t *smp;
+    for (int k=1;(smp = recent_sample(h, k, now_s, width));k++) {
+        int col = width - 1 - (int)(now_s - smp->t_s);
+        if (cols[col] < 0) cols[col] = smp->v[m];
+        if (smp->v[m] > top) top = smp->v[m];
+    }
+    for (int i=0;i<width;i++) {
+        if (cols[i] < 0) printf(" ");
+        else printf("%s", BARS[cols[i] * 7 / top]);
+    }
+}
+
 int main() {
     if (open_ipc() != 0) {
         fprintf(stderr, "Failed to open shared memory (is producer/consumer running?).\n");
@@ -195,9 +256,9 @@ int main() {
         shm_state_t snapshot;
         int have_snapshot = 0;
         if (st) {
-            if (sem_mutex) sem_wait(sem_mutex);
+            shm_lock(st);
             snapshot = *st; /* copy whole struct */
-            if (sem_mutex) sem_post(sem_mutex);
+            shm_unlock(st);
             have_snapshot = 1;
         }
 
@@ -223,17 +284,17 @@ int main() {
             printf("  RWY-%d: ", r+1);
             if (have_snapshot && snapshot.runway_in_use[r] != 0) {
                 ANSI_YELLOW(); printf("OCCUPIED "); ANSI_RESET();
-                printf("(PID %d) ", snapshot.runway_in_use[r]);
+                if (snapshot.runway_in_use[r] == RUNWAY_RESERVED) printf("(dispatching) ");
+                else printf("(PID %d) ", snapshot.runway_in_use[r]);
               
                 printf("%s ", SPINNER[spinner_frame % SPINNER_FRAMES]);
-                draw_occupancy_bar(20, spinner_frame);
-                printf("\n");
             } else {
                 ANSI_GREEN(); printf("FREE"); ANSI_RESET();
                 printf(" ");
-                draw_occupancy_bar(20, spinner_frame);
-                printf("\n");
             }
+            double busy = have_snapshot ? runway_busy_fraction(&snapshot.hist, r, now_ns() / 1000000000L) : 0.0;
+            draw_occupancy_bar(20, busy);
+            printf(" %3.0f%% busy (1m)\n", busy * 100);
         }
         printf("\n");
 
@@ -264,11 +325,36 @@ int main() {
         if (have_snapshot) {
             printf("Metrics: total_assigned=%d  total_busy_ms=%ld  queue_len=%d\n",
                    snapshot.total_assigned, snapshot.total_busy_ms, snapshot.q_count);
+            if (snapshot.lat_count > 0) {
+                long p50 = lat_percentile_us(&snapshot, 0.50);
+                long p999 = lat_percentile_us(&snapshot, 0.999);
+                printf("Dispatch latency: n=%lu  min=%ldus  mean=%.0fus  p50<=%ldus  p99<=%ldus  p99.9<=%ldus  max=%ldus  jitter(p99.9-p50)=%ldus\n",
+                       snapshot.lat_count, snapshot.lat_min_ns / 1000, snapshot.lat_sum_us / snapshot.lat_count, p50,
+                       lat_percentile_us(&snapshot, 0.99), p999, snapshot.lat_max_ns / 1000, p999 - p50);
+            }
         } else {
             printf("Metrics: (no shared memory)\n");
         }
         printf("\n");
 
+        if (have_snapshot && snapshot.hist.count > 0) {
+            static const char *METRIC_NAMES[HIST_METRICS] = { "queue", "dispatch/s", "runways", "emergency" };
+            int spark_w = term_width() - 24;
+            if (spark_w > HIST_SECONDS) spark_w = HIST_SECONDS;
+            if (spark_w < 10) spark_w = 10;
+            printf("Trends (1 sample/s, last %d s):\n", spark_w);
+            long now_s = now_ns() / 1000000000L;
+            const hist_sample_t *last = recent_sample(&snapshot.hist, 1, now_s, 3);
+            for (int m=0;m<HIST_METRICS;m++) {
+                printf("  %-12s", METRIC_NAMES[m]);
+                ANSI_CYAN(); draw_sparkline(&snapshot.hist, m, spark_w, now_s); ANSI_RESET();
+                if (last) printf(" %4d\n", last->v[m]);
+                else printf("    -\n");
+                print_window_stats(&snapshot.hist, m, now_s);
+            }
+            printf("\n");
+        }
+
         int w = term_width();
         int mid = w / 2;
         /* sky line */
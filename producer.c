@@ -5,23 +5,17 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <sys/shm.h>
 #include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <errno.h>
 #include "shared.h"
 
-#define SEM_MUTEX_NAME "/airport_mutex"
-#define SEM_ITEMS_NAME "/airport_items"
-#define SEM_SPACES_NAME "/airport_spaces"
-#define SEM_RUNWAYS_NAME "/airport_runways"
-
 static shm_state_t *st = NULL;
-static int shm_id = -1;
-static sem_t *sem_mutex = NULL;
-static sem_t *sem_items = NULL;
-static sem_t *sem_spaces = NULL;
-static sem_t *sem_runways = NULL;
+static spill_t *spill = NULL;
+static int enq_timeout_ms = -1;  /* <0 block, 0 reject when full, >0 timed */
 
 void die(const char *msg) {
     perror(msg);
@@ -29,46 +23,176 @@ void die(const char *msg) {
 }
 
 void open_ipc() {
-    shm_id = shmget(SHM_KEY, sizeof(shm_state_t), IPC_CREAT | 0666);
-    if (shm_id < 0) die("shmget");
-    st = (shm_state_t*) shmat(shm_id, NULL, 0);
-    if (st == (void*)-1) die("shmat");
-
-    sem_mutex = sem_open(SEM_MUTEX_NAME, O_CREAT, 0666, 1);
-    if (sem_mutex == SEM_FAILED) die("sem_open mutex");
-    sem_items = sem_open(SEM_ITEMS_NAME, O_CREAT, 0666, 0);
-    if (sem_items == SEM_FAILED) die("sem_open items");
-    sem_spaces = sem_open(SEM_SPACES_NAME, O_CREAT, 0666, MAX_FLIGHTS);
-    if (sem_spaces == SEM_FAILED) die("sem_open spaces");
-    sem_runways = sem_open(SEM_RUNWAYS_NAME, O_CREAT, 0666, RUNWAYS);
-    if (sem_runways == SEM_FAILED) die("sem_open runways");
+    st = shm_attach(1, 0);
+    if (!st) die("shm_attach");
 }
 
-void add_flight(const char *name, int type, int duration_ms, int emergency) {
-    sem_wait(sem_spaces);
-    sem_wait(sem_mutex);
+/*
+ * Every process must use the same spill file, so its absolute path lives in
+ * st->spill_path. The first -s producer publishes SPILL_FILE resolved against
+ * its cwd; later ones follow the published path whatever their cwd.
+ */
+void open_spill() {
+    char path[SPILL_PATH_MAX];
+    shm_lock(st);
+    strcpy(path, st->spill_path[0] ? st->spill_path : SPILL_FILE);
+    shm_unlock(st);
+
+    while (1) {
+        int fd = open(path, O_RDWR | O_CREAT, 0666);
+        if (fd < 0) die("open spill");
+        struct stat sb;
+        if (fstat(fd, &sb) < 0) die("fstat spill");
+        if (sb.st_size < (off_t)sizeof(spill_t) && ftruncate(fd, sizeof(spill_t)) < 0) die("ftruncate spill");
+        spill = mmap(NULL, sizeof(spill_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (spill == MAP_FAILED) die("mmap spill");
+        close(fd);
+
+        char *resolved = realpath(path, NULL);
+        if (!resolved) die("realpath spill");
+        if (strlen(resolved) >= SPILL_PATH_MAX) {
+            fprintf(stderr, "spill path %s is longer than %d bytes\n", resolved, SPILL_PATH_MAX - 1);
+            exit(1);
+        }
+
+        shm_lock(st);
+        if (!st->spill_path[0]) strcpy(st->spill_path, resolved);
+        int ours = strcmp(st->spill_path, resolved) == 0;
+        if (!ours) strcpy(path, st->spill_path);
+        shm_unlock(st);
+        free(resolved);
+        if (ours) return;
+
+        /* another producer published a different file first; use that one */
+        munmap(spill, sizeof(spill_t));
+        spill = NULL;
+    }
+}
+
+/* caller holds st->lock and has checked there is a free slot */
+void queue_push(const flight_t *f) {
     int idx = st->q_tail;
+    st->q[idx] = *f;
     st->q[idx].used = 1;
-    st->q[idx].id = st->next_id++;
-    strncpy(st->q[idx].name, name, MAX_NAME_LEN-1);
-    st->q[idx].name[MAX_NAME_LEN-1] = 0;
-    st->q[idx].type = type;
-    st->q[idx].emergency = emergency ? 1 : 0;
-    st->q[idx].duration_ms = duration_ms;
     st->q_tail = (st->q_tail + 1) % MAX_FLIGHTS;
     st->q_count++;
-    printf("[producer] Enqueued id=%d name=%s type=%s dur=%dms em=%d\n",
-           st->q[idx].id, st->q[idx].name, (type==FL_LANDING?"LAND":"TKOF"),
-           duration_ms, emergency);
-    sem_post(sem_mutex);
-    sem_post(sem_items);
+}
+
+/*
+ * caller holds st->lock. A spill file left over from an earlier segment
+ * (after ipcrm or a reboot) holds ids that the new segment will hand out
+ * again, so its flights are dropped rather than drained.
+ */
+void adopt_spill() {
+    if (spill->generation != st->generation) {
+        if (spill->count > 0) printf("[producer] Discarding %d spilled flights from an earlier session\n", spill->count);
+        spill->head = spill->tail = spill->count = 0;
+        spill->generation = st->generation;
+    }
+    st->spill_count = spill->count;
+}
+
+/* caller holds st->lock; moves spilled flights into free slots, oldest first */
+void drain_spill() {
+    while (spill->count > 0 && st->q_count < MAX_FLIGHTS) {
+        flight_t *f = &spill->q[spill->head];
+        queue_push(f);
+        printf("[producer] Moved spilled id=%d name=%s into queue\n", f->id, f->name);
+        spill->head = (spill->head + 1) % SPILL_MAX;
+        spill->count--;
+        pthread_cond_signal(&st->items_cv);
+    }
+    st->spill_count = spill->count;
+}
+
+void make_flight(flight_t *f, const char *name, int type, int duration_ms, int emergency) {
+    memset(f, 0, sizeof(*f));
+    f->used = 1;
+    f->id = st->next_id++;
+    strncpy(f->name, name, MAX_NAME_LEN-1);
+    f->type = type;
+    f->emergency = emergency ? 1 : 0;
+    f->duration_ms = duration_ms;
+}
+
+/*
+ * caller holds st->lock. While anything is spilled a free slot belongs to
+ * the oldest spilled flight, so producers without -s must not take it.
+ */
+int queue_full() {
+    return st->q_count >= MAX_FLIGHTS || st->spill_count > 0;
+}
+
+/* caller holds st->lock; waits for a free queue slot according to timeout_ms */
+int wait_space(int timeout_ms) {
+    if (!queue_full()) return ENQ_OK;
+    if (timeout_ms == 0) return ENQ_FULL;
+    if (timeout_ms < 0) {
+        while (queue_full()) shm_wait(st, &st->spaces_cv);
+        return ENQ_OK;
+    }
+    struct timespec deadline = shm_deadline(timeout_ms);
+    while (queue_full()) {
+        if (shm_timedwait(st, &st->spaces_cv, &deadline) == ETIMEDOUT && queue_full())
+            return ENQ_TIMEOUT;
+    }
+    return ENQ_OK;
+}
+
+/*
+ * Returns ENQ_OK, ENQ_SPILLED, ENQ_FULL or ENQ_TIMEOUT. With the spill file
+ * open a full queue never blocks: the flight goes to the spill ring, and
+ * once anything is spilled new flights queue behind it to keep FIFO order.
+ */
+int enqueue_flight(const char *name, int type, int duration_ms, int emergency, int timeout_ms) {
+    flight_t f;
+    int rc;
+    shm_lock(st);
+    if (spill) {
+        if (spill->count == 0 && st->q_count < MAX_FLIGHTS) {
+            make_flight(&f, name, type, duration_ms, emergency);
+            queue_push(&f);
+            pthread_cond_signal(&st->items_cv);
+            rc = ENQ_OK;
+        } else if (spill->count >= SPILL_MAX) {
+            rc = ENQ_FULL;
+        } else {
+            make_flight(&f, name, type, duration_ms, emergency);
+            spill->q[spill->tail] = f;
+            spill->tail = (spill->tail + 1) % SPILL_MAX;
+            spill->count++;
+            drain_spill();
+            rc = ENQ_SPILLED;
+        }
+    } else {
+        rc = wait_space(timeout_ms);
+        if (rc == ENQ_OK) {
+            make_flight(&f, name, type, duration_ms, emergency);
+            queue_push(&f);
+            pthread_cond_signal(&st->items_cv);
+        }
+    }
+    shm_unlock(st);
+    if (rc == ENQ_OK || rc == ENQ_SPILLED) {
+        printf("[producer] %s id=%d name=%s type=%s dur=%dms em=%d\n",
+               rc == ENQ_OK ? "Enqueued" : "Spilled", f.id, f.name,
+               (type==FL_LANDING?"LAND":"TKOF"), duration_ms, emergency);
+    }
+    return rc;
+}
+
+void add_flight(const char *name, int type, int duration_ms, int emergency) {
+    int rc = enqueue_flight(name, type, duration_ms, emergency, enq_timeout_ms);
+    if (rc == ENQ_FULL) printf("[producer] Rejected %s: queue full\n", name);
+    else if (rc == ENQ_TIMEOUT) printf("[producer] Rejected %s: timed out after %dms\n", name, enq_timeout_ms);
 }
 
 void print_status() {
-    sem_wait(sem_mutex);
+    shm_lock(st);
     printf("=== STATUS (producer view) ===\n");
     printf("Severe weather: %s\n", st->severe_weather ? "ON" : "OFF");
     printf("Queue count: %d\n", st->q_count);
+    if (st->spill_count) printf("Spilled to disk: %d\n", st->spill_count);
     int i = st->q_head;
     for (int k=0;k<st->q_count;k++) {
         flight_t *f = &st->q[i];
@@ -80,11 +204,11 @@ void print_status() {
         printf("Runway %d: %s\n", r+1, st->runway_in_use[r] ? "IN USE" : "FREE");
     }
     printf("Total assigned: %d, total busy ms: %ld\n", st->total_assigned, st->total_busy_ms);
-    sem_post(sem_mutex);
+    shm_unlock(st);
 }
 
 void mark_emergency(int id) {
-    sem_wait(sem_mutex);
+    shm_lock(st);
     int found = 0;
     int idx = st->q_head;
     for (int k=0;k<st->q_count;k++) {
@@ -97,10 +221,26 @@ void mark_emergency(int id) {
         }
         idx = (idx+1) % MAX_FLIGHTS;
     }
-    if (!found) printf("[producer] id=%d not found in queue\n", id);
-    sem_post(sem_mutex);
-   
-    sem_post(sem_items);
+    if (!found && spill) {
+        idx = spill->head;
+        for (int k=0;k<spill->count;k++) {
+            if (spill->q[idx].id == id) {
+                spill->q[idx].emergency = 1;
+                found = 1;
+                printf("[producer] Marked spilled id=%d as EMERGENCY\n", id);
+                break;
+            }
+            idx = (idx+1) % SPILL_MAX;
+        }
+    }
+    if (!found && !spill && st->spill_count > 0) {
+        printf("[producer] id=%d not found in queue (%d spilled flights not searched, run with -s)\n", id, st->spill_count);
+    } else if (!found) {
+        printf("[producer] id=%d not found in queue\n", id);
+    } else {
+        pthread_cond_signal(&st->items_cv);
+    }
+    shm_unlock(st);
 }
 
 int parse_type(const char *s) {
@@ -110,22 +250,28 @@ int parse_type(const char *s) {
 }
 
 int main(int argc, char **argv) {
+    int opt_c;
+    int use_spill = 0;
+    while ((opt_c = getopt(argc, argv, "t:s")) != -1) {
+        if (opt_c == 't') enq_timeout_ms = atoi(optarg);
+        else if (opt_c == 's') use_spill = 1;
+        else {
+            fprintf(stderr, "usage: %s [-t enqueue_timeout_ms] [-s] [schedule]\n", argv[0]);
+            return 1;
+        }
+    }
     open_ipc();
+    if (use_spill) open_spill();
 
-    sem_wait(sem_mutex);
-    if (st->next_id == 0) {
-        st->q_head = st->q_tail = st->q_count = 0;
-        for (int i=0;i<MAX_FLIGHTS;i++) st->q[i].used = 0;
-        for (int r=0;r<RUNWAYS;r++) st->runway_in_use[r] = 0;
-        st->severe_weather = 0;
-        st->total_assigned = 0;
-        st->total_busy_ms = 0;
-        st->next_id = 1;
+    if (spill) {
+        shm_lock(st);
+        adopt_spill();
+        drain_spill();
+        shm_unlock(st);
     }
-    sem_post(sem_mutex);
 
-    if (argc >= 2) {
-        FILE *f = fopen(argv[1],"r");
+    if (optind < argc) {
+        FILE *f = fopen(argv[optind],"r");
         if (!f) {
             perror("open schedule");
            
@@ -176,12 +322,11 @@ int main(int argc, char **argv) {
             int id = atoi(ibuf);
             if (id>0) mark_emergency(id);
         } else if (opt == 3) {
-            sem_wait(sem_mutex);
+            shm_lock(st);
             st->severe_weather = !st->severe_weather;
             printf("Severe weather set to %d\n", st->severe_weather);
-            sem_post(sem_mutex);
-         
-            sem_post(sem_items);
+            pthread_cond_signal(&st->items_cv);
+            shm_unlock(st);
         } else if (opt == 4) {
             print_status();
         } else if (opt == 5) {
@@ -193,6 +338,7 @@ int main(int argc, char **argv) {
     }
 
    
+    if (spill) munmap(spill, sizeof(spill_t));
     shmdt(st);
   
     return 0;
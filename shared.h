@@ -3,16 +3,50 @@
 #define SHARED_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #define SHM_KEY 0xBEEFBEEF
+#define SHM_MAGIC 0x41495250  /* set once the locks below are initialised */
 #define MAX_FLIGHTS 256
 #define MAX_NAME_LEN 32
 #define RUNWAYS 2
+#define RUNWAY_RESERVED -1  /* runway_in_use[] while the consumer forks its worker */
 
 
 #define FL_LANDING  1
 #define FL_TAKEOFF  2
 
+#define SPILL_FILE "airport_spill.dat"  /* created relative to the first -s producer */
+#define SPILL_PATH_MAX 256
+#define SPILL_MAX 65536
+
+#define ENQ_OK       0
+#define ENQ_SPILLED  1
+#define ENQ_FULL    -1
+#define ENQ_TIMEOUT -2
+
+#define LAT_BUCKETS 32   /* bucket b counts latencies in [2^b, 2^(b+1)) us */
+
+/* per-second history sampled by the consumer */
+#define HM_QUEUE      0   /* queued flights */
+#define HM_RATE       1   /* dispatches in the last second */
+#define HM_OCCUPANCY  2   /* runways in use */
+#define HM_EMERGENCY  3   /* queued emergency flights */
+#define HIST_METRICS  4
+#define HIST_SECONDS  120 /* raw 1 s samples kept */
+#define HIST_SLOTS    60  /* max buckets per aggregate tier */
+#define HIST_TIERS    2   /* 1-minute buckets for the last hour, 1-hour buckets for the last day */
+
 typedef struct {
     int used;                     
     int id;                       
@@ -23,7 +57,44 @@ typedef struct {
 } flight_t;
 
 typedef struct {
-    
+    long t_s;                     /* CLOCK_MONOTONIC second the sample was taken */
+    int v[HIST_METRICS];
+    unsigned int runway_mask;     /* bit r set while runway r was busy */
+} hist_sample_t;
+
+typedef struct {
+    int n;                        /* samples folded in, 0 for an empty bucket */
+    int min[HIST_METRICS];
+    int max[HIST_METRICS];
+    long sum[HIST_METRICS];
+} hist_agg_t;
+
+typedef struct {
+    int span_s;                   /* seconds covered by one bucket */
+    int slots;                    /* buckets kept, <= HIST_SLOTS */
+    int head;                     /* bucket being filled */
+    int count;                    /* buckets in use, including head */
+    long cur_id;                  /* sample time / span_s of the head bucket */
+    hist_agg_t b[HIST_SLOTS];
+} hist_tier_t;
+
+typedef struct {
+    long next_ns;                 /* when the next sample is due, 0 before the first */
+    int last_dispatched;
+    int head;                     /* next slot to write in sec[] */
+    int count;
+    hist_sample_t sec[HIST_SECONDS];
+    hist_tier_t tier[HIST_TIERS];
+} history_t;
+
+typedef struct {
+    unsigned int magic;
+    unsigned long generation;   /* picked at creation; ties the spill file to this segment */
+    pthread_mutex_t lock;       /* robust, process-shared; guards everything below */
+    pthread_cond_t items_cv;    /* flight queued, or dispatch rules changed */
+    pthread_cond_t spaces_cv;   /* queue slot freed */
+    pthread_cond_t runway_cv;   /* runway freed */
+
     flight_t q[MAX_FLIGHTS];
     int q_head;
     int q_tail;
@@ -34,7 +105,191 @@ typedef struct {
     int total_assigned;
     long total_busy_ms; 
     int next_id;
+    int spill_count;   /* flights waiting in the spill file */
+    char spill_path[SPILL_PATH_MAX];  /* absolute path of that file, "" until a producer adopts one */
+
+    /* runway-free -> next-dispatch latency, recorded by the consumer */
+    long runway_freed_ns[RUNWAYS];
+    unsigned long lat_hist[LAT_BUCKETS];
+    unsigned long lat_count;
+    long lat_min_ns;
+    long lat_max_ns;
+    double lat_sum_us;
+
+    int total_dispatched;
+    history_t hist;
 } shm_state_t;
 
+/* overflow ring kept in SPILL_FILE, guarded by the same mutex as the queue */
+typedef struct {
+    unsigned long generation;     /* shm_state_t.generation of the segment it belongs to */
+    int head;
+    int tail;
+    int count;
+    flight_t q[SPILL_MAX];
+} spill_t;
+
+/*
+ * Lock helpers shared by producer, consumer and monitor. The mutex is robust:
+ * if a holder dies, the next locker gets EOWNERDEAD, repairs the state and
+ * marks the mutex consistent instead of deadlocking the airport.
+ */
+static inline void shm_repair(shm_state_t *s) {
+    /* queued slots are contiguous from q_head with used set; rebuild count and tail from them */
+    s->q_head = (s->q_head % MAX_FLIGHTS + MAX_FLIGHTS) % MAX_FLIGHTS;
+    int n = 0;
+    while (n < MAX_FLIGHTS && s->q[(s->q_head + n) % MAX_FLIGHTS].used) n++;
+    s->q_count = n;
+    s->q_tail = (s->q_head + n) % MAX_FLIGHTS;
+    for (int r=0;r<RUNWAYS;r++) {
+        pid_t pid = s->runway_in_use[r];
+        if (pid > 0 && kill(pid, 0) < 0 && errno == ESRCH) s->runway_in_use[r] = 0;
+    }
+    pthread_cond_broadcast(&s->items_cv);
+    pthread_cond_broadcast(&s->spaces_cv);
+    pthread_cond_broadcast(&s->runway_cv);
+}
+
+static inline void shm_check(shm_state_t *s, int rc, const char *what) {
+    if (rc == EOWNERDEAD) {
+        fprintf(stderr, "[pid=%d] previous lock holder died, repairing state\n", getpid());
+        shm_repair(s);
+        pthread_mutex_consistent(&s->lock);
+    } else if (rc != 0 && rc != ETIMEDOUT) {
+        errno = rc;
+        perror(what);
+        exit(1);
+    }
+}
+
+static inline void shm_lock(shm_state_t *s) {
+    shm_check(s, pthread_mutex_lock(&s->lock), "pthread_mutex_lock");
+}
+
+static inline void shm_unlock(shm_state_t *s) {
+    pthread_mutex_unlock(&s->lock);
+}
+
+static inline void shm_wait(shm_state_t *s, pthread_cond_t *cv) {
+    shm_check(s, pthread_cond_wait(cv, &s->lock), "pthread_cond_wait");
+}
+
+static inline long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* caller holds s->lock */
+static inline void lat_record(shm_state_t *s, long ns) {
+    if (ns < 0) ns = 0;
+    long us = ns / 1000;
+    int b = 0;
+    while (b < LAT_BUCKETS-1 && (us >> (b+1)) > 0) b++;
+    s->lat_hist[b]++;
+    if (s->lat_count == 0 || ns < s->lat_min_ns) s->lat_min_ns = ns;
+    if (ns > s->lat_max_ns) s->lat_max_ns = ns;
+    s->lat_count++;
+    s->lat_sum_us += ns / 1000.0;
+}
+
+/* upper bound in us of the bucket holding quantile q (0..1), capped at the max; 0 with no samples */
+static inline long lat_percentile_us(const shm_state_t *s, double q) {
+    if (s->lat_count == 0) return 0;
+    unsigned long want = (unsigned long)(q * s->lat_count);
+    if (want >= s->lat_count) want = s->lat_count - 1;
+    long max_us = s->lat_max_ns / 1000;
+    unsigned long seen = 0;
+    for (int b=0;b<LAT_BUCKETS;b++) {
+        seen += s->lat_hist[b];
+        if (seen > want) return (2L << b) < max_us ? (2L << b) : max_us;
+    }
+    return max_us;
+}
+
+/* absolute CLOCK_MONOTONIC deadline for shm_timedwait() */
+static inline struct timespec shm_deadline(int timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return ts;
+}
+
+/* returns ETIMEDOUT once the deadline passes, 0 otherwise */
+static inline int shm_timedwait(shm_state_t *s, pthread_cond_t *cv, const struct timespec *deadline) {
+    int rc = pthread_cond_timedwait(cv, &s->lock, deadline);
+    shm_check(s, rc, "pthread_cond_timedwait");
+    return rc == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+static inline void shm_init_sync(shm_state_t *s) {
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    /* a SCHED_FIFO consumer (-p) must not wait behind a preempted SCHED_OTHER holder */
+    pthread_mutexattr_setprotocol(&ma, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&s->lock, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->items_cv, &ca);
+    pthread_cond_init(&s->spaces_cv, &ca);
+    pthread_cond_init(&s->runway_cv, &ca);
+    pthread_condattr_destroy(&ca);
+}
+
+/*
+ * Attach the airport segment. With create set, the first process to get here
+ * creates and initialises it; everyone else waits until the magic is
+ * published. extra_flags (e.g. SHM_HUGETLB) only apply when we create it.
+ * Returns NULL (errno set) if the segment cannot be attached.
+ */
+static inline shm_state_t *shm_attach(int create, int extra_flags) {
+    int creator = 0;
+    int id = -1;
+    if (create) {
+        id = shmget(SHM_KEY, sizeof(shm_state_t), IPC_CREAT | IPC_EXCL | extra_flags | 0666);
+        if (id >= 0) creator = 1;
+        else if (errno != EEXIST) return NULL;
+    }
+    if (id < 0) id = shmget(SHM_KEY, sizeof(shm_state_t), 0666);
+    if (id < 0) {
+        /* EINVAL: the segment was created by a build with a smaller shm_state_t */
+        if (errno == EINVAL) {
+            fprintf(stderr, "shared memory 0x%X has an old layout; remove it with: ipcrm -M 0x%X\n",
+                    SHM_KEY, SHM_KEY);
+            errno = EINVAL;
+        }
+        return NULL;
+    }
+    shm_state_t *s = (shm_state_t*) shmat(id, NULL, 0);
+    if (s == (void*)-1) return NULL;
+
+    if (creator) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        shm_init_sync(s);
+        s->generation = ((unsigned long) ts.tv_sec * 1000000000UL + ts.tv_nsec) ^ ((unsigned long) getpid() << 32);
+        s->next_id = 1;
+        __atomic_store_n(&s->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+        return s;
+    }
+    for (int tries=0; __atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC; tries++) {
+        if (tries >= 500) {
+            shmdt(s);
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        usleep(10000);
+    }
+    return s;
+}
+
 #endif
 